@@ -1,14 +1,104 @@
 #include "FileTransformers.h"
 
 #include "Utils.h"
+#include "Telemetry.h"
 
 #include "WINEXCLUDE.H"
 #include <windows.h>
+#include <winioctl.h>
 #include <tchar.h>
+#include <io.h>
 #include <cstdio>
+#include <cstring>
+#include <algorithm>
 #include <memory>
 #include <fstream>
 #include <iostream>
+#include <vector>
+
+namespace
+{
+	// in write-behind mode the output is flushed after every window of written bytes
+	const uint64_t WriteBehindWindowInBytes = 32 * 1024 * 1024;
+
+	// [offset, offset + length) part of a file that contains data
+	struct FileRange
+	{
+		uint64_t m_offset;
+		uint64_t m_length;
+	};
+
+	// returns allocated (data) ranges of the file, holes of sparse files are skipped
+	// if the file system cannot answer the whole file is returned as one range
+	std::vector<FileRange> QueryDataRanges(HANDLE hFile, uint64_t fileSize)
+	{
+		std::vector<FileRange> ranges;
+
+		FILE_ALLOCATED_RANGE_BUFFER queryRange;
+		queryRange.FileOffset.QuadPart = 0;
+		queryRange.Length.QuadPart = static_cast<LONGLONG>(fileSize);
+
+		FILE_ALLOCATED_RANGE_BUFFER outRanges[64];
+		while (queryRange.Length.QuadPart > 0)
+		{
+			DWORD bytesReturned = 0;
+			const BOOL queryOK = DeviceIoControl(hFile, FSCTL_QUERY_ALLOCATED_RANGES, &queryRange, sizeof(queryRange), outRanges, sizeof(outRanges), &bytesReturned, /*overlapped*/nullptr);
+			if (!queryOK && GetLastError() != ERROR_MORE_DATA)
+			{
+				printf("Cannot query allocated ranges, processing the whole file...\n");
+				ranges.clear();
+				ranges.push_back(FileRange{ 0, fileSize });
+				return ranges;
+			}
+
+			const size_t rangeCount = bytesReturned / sizeof(FILE_ALLOCATED_RANGE_BUFFER);
+			for (size_t i = 0; i < rangeCount; ++i)
+			{
+				const uint64_t offset = static_cast<uint64_t>(outRanges[i].FileOffset.QuadPart);
+				const uint64_t end = std::min<uint64_t>(offset + static_cast<uint64_t>(outRanges[i].Length.QuadPart), fileSize);
+				if (offset < end)
+					ranges.push_back(FileRange{ offset, end - offset });
+			}
+
+			if (queryOK || rangeCount == 0)
+				break;
+
+			// ERROR_MORE_DATA: continue after the last returned range
+			const auto& lastRange = outRanges[rangeCount - 1];
+			queryRange.FileOffset.QuadPart = lastRange.FileOffset.QuadPart + lastRange.Length.QuadPart;
+			queryRange.Length.QuadPart = static_cast<LONGLONG>(fileSize) - queryRange.FileOffset.QuadPart;
+		}
+
+		return ranges;
+	}
+
+	// sparse output file: regions that are never written stay as holes
+	bool MakeSparse(HANDLE hFile)
+	{
+		DWORD bytesReturned = 0;
+		if (DeviceIoControl(hFile, FSCTL_SET_SPARSE, nullptr, 0, nullptr, 0, &bytesReturned, /*overlapped*/nullptr))
+			return true;
+
+		printf("Cannot mark output file as sparse, holes will be written as zeros...\n");
+		return false;
+	}
+
+	// sets the final size of the output, the tail that was not written becomes a hole (or zeros for non-sparse files)
+	bool SetFileSize(HANDLE hFile, uint64_t fileSize)
+	{
+		LARGE_INTEGER pos;
+		pos.QuadPart = static_cast<LONGLONG>(fileSize);
+		return SetFilePointerEx(hFile, pos, nullptr, FILE_BEGIN) && SetEndOfFile(hFile);
+	}
+
+	uint64_t SumRanges(const std::vector<FileRange>& ranges)
+	{
+		uint64_t sum = 0;
+		for (const auto& range : ranges)
+			sum += range.m_length;
+		return sum;
+	}
+}
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -16,7 +106,7 @@
 
 bool StdioFileTransformer::Process(TProcessFunc processFunc)
 {
-	FILE_unique_ptr pInputFilePtr = make_fopen(m_strFirstFile.c_str(), m_useSequential ? L"rbS" : L"rb");
+	FILE_unique_ptr pInputFilePtr = make_fopen(m_strFirstFile.c_str(), m_options.m_sequential ? L"rbS" : L"rb");
 	if (!pInputFilePtr)
 		return false;
 
@@ -26,6 +116,21 @@ bool StdioFileTransformer::Process(TProcessFunc processFunc)
 
 	auto inBuf = std::make_unique<uint8_t[]>(m_blockSizeInBytes);
 	auto outBuf = std::make_unique<uint8_t[]>(m_blockSizeInBytes);
+	// CRT buffer into the OS, then OS cache onto the disk; the cached pages stay in memory, only dirty data is bounded
+	WriteBehindTracker writeBehind(WriteBehindWindowInBytes);
+	bool flushOK = true;
+	auto flushOutput = [&]()
+	{
+		writeBehind.SampleSystemCache();
+		if (fflush(pOutputFilePtr.get()) == 0 && _commit(_fileno(pOutputFilePtr.get())) == 0)
+			writeBehind.Flushed();
+		else
+		{
+			Logger::PrintCannotFlushFile(m_strSecondFile);
+			flushOK = false;
+		}
+	};
+
 	size_t blockCount = 0;
 	while (!feof(pInputFilePtr.get()))
 	{
@@ -48,12 +153,24 @@ bool StdioFileTransformer::Process(TProcessFunc processFunc)
 		if (numRead != numWritten)
 			Logger::PrintErrorTransformingFile(numRead, numWritten);
 
+		if (m_options.m_pTelemetry)
+			m_options.m_pTelemetry->AddBlock(numWritten);
+
+		if (m_options.m_writeBehind && writeBehind.AddWritten(numWritten))
+			flushOutput();
+
 		blockCount++;
 	}
 
+	if (m_options.m_writeBehind)
+	{
+		flushOutput();
+		Logger::PrintWriteBehindSummary(writeBehind);
+	}
+
 	Logger::PrintTransformSummary(blockCount, m_blockSizeInBytes, m_strFirstFile, m_strSecondFile);
 
-	return true;
+	return flushOK;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -100,6 +217,9 @@ bool IoStreamFileTransformer::Process(TProcessFunc processFunc)
 		if (outputStream.bad())
 			Logger::PrintErrorTransformingFile(numRead, static_cast<size_t>(outputStream.tellp() - posBefore));
 
+		if (m_options.m_pTelemetry)
+			m_options.m_pTelemetry->AddBlock(numRead);
+
 		blockCount++;
 	}
 
@@ -111,62 +231,224 @@ bool IoStreamFileTransformer::Process(TProcessFunc processFunc)
 ///////////////////////////////////////////////////////////////////////////////
 // WinFileTransformer
 
+namespace
+{
+	// FILE_FLAG_NO_BUFFERING needs sector aligned buffers, offsets and sizes, page size covers 512 and 4K sectors
+	const DWORD UnbufferedAlignment = 4096;
+
+	uint64_t RoundUp(uint64_t value, uint64_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	// reads, transforms and writes blocks from the current file positions, stops after maxBytes or at the end of the input
+	// ioAlignment > 1 pads reads and writes for unbuffered handles, the caller sets the final file size
+	// pWriteBehind is optional, when set the output is flushed every time its window fills up
+	// pTelemetry is optional, it gets every written block
+	bool TransformBlocks(HANDLE hInputFile, HANDLE hOutputFile, const std::wstring& strOutputFile, uint8_t* inBuf, uint8_t* outBuf, DWORD blockSizeInBytes, DWORD ioAlignment, uint64_t maxBytes, IFileTransformer::TProcessFunc processFunc, size_t& blockCount, WriteBehindTracker* pWriteBehind, TransferTelemetry* pTelemetry)
+	{
+		DWORD numBytesRead = 0;
+		DWORD numBytesWritten = 0;
+		BOOL writeOK = TRUE;
+		uint64_t bytesLeft = maxBytes;
+		while (bytesLeft > 0 && writeOK)
+		{
+			const DWORD numBytesToRead = static_cast<DWORD>(RoundUp(std::min<uint64_t>(blockSizeInBytes, bytesLeft), ioAlignment));
+			if (!ReadFile(hInputFile, inBuf, numBytesToRead, &numBytesRead, /*overlapped*/nullptr))
+				return false;
+
+			if (numBytesRead == 0)
+				break;
+
+			processFunc(inBuf, outBuf, numBytesRead);
+
+			// the tail of the file is padded with zeros, SetEndOfFile cuts it off later
+			const DWORD numBytesToWrite = static_cast<DWORD>(RoundUp(numBytesRead, ioAlignment));
+			memset(outBuf + numBytesRead, 0, numBytesToWrite - numBytesRead);
+
+			writeOK = WriteFile(hOutputFile, outBuf, numBytesToWrite, &numBytesWritten, /*overlapped*/nullptr);
+
+			if (numBytesToWrite != numBytesWritten)
+				Logger::PrintErrorTransformingFile(numBytesToWrite, numBytesWritten);
+
+			if (pTelemetry)
+				pTelemetry->AddBlock(numBytesRead);
+
+			if (pWriteBehind && pWriteBehind->AddWritten(numBytesWritten))
+			{
+				pWriteBehind->SampleSystemCache();
+				if (!FlushFileBuffers(hOutputFile))
+				{
+					Logger::PrintCannotFlushFile(strOutputFile);
+					return false;
+				}
+				pWriteBehind->Flushed();
+			}
+
+			bytesLeft -= std::min<uint64_t>(numBytesRead, bytesLeft);
+			blockCount++;
+
+			// short read means the end of the input, for unbuffered handles the file pointer isn't aligned anymore
+			if (numBytesRead < numBytesToRead)
+				break;
+		}
+
+		return writeOK != FALSE;
+	}
+}
+
 bool WinFileTransformer::Process(TProcessFunc processFunc)
 {
-	auto hInputFile = make_HANDLE_unique_ptr(CreateFile(m_strFirstFile.c_str(), GENERIC_READ, /*shared mode*/0, /*security*/nullptr, OPEN_EXISTING, m_useSequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, /*template*/nullptr), m_strFirstFile);
+	// write-behind bypasses the file cache: nothing of the input or output stays cached, and writes go through to the disk,
+	// Windows has no fadvise(DONTNEED) to evict pages of a buffered handle
+	const bool unbuffered = m_options.m_writeBehind;
+	DWORD inputFlags = m_options.m_sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL;
+	DWORD outputFlags = FILE_ATTRIBUTE_NORMAL;
+	if (unbuffered)
+	{
+		inputFlags |= FILE_FLAG_NO_BUFFERING;
+		outputFlags |= FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH;
+	}
+
+	auto hInputFile = make_HANDLE_unique_ptr(CreateFile(m_strFirstFile.c_str(), GENERIC_READ, /*shared mode*/0, /*security*/nullptr, OPEN_EXISTING, inputFlags, /*template*/nullptr), m_strFirstFile);
 	if (!hInputFile)
 		return false;
 
-	auto hOutputFile = make_HANDLE_unique_ptr(CreateFile(m_strSecondFile.c_str(), GENERIC_WRITE, /*shared mode*/0, /*security*/nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, /*template*/nullptr), m_strSecondFile);
+	auto hOutputFile = make_HANDLE_unique_ptr(CreateFile(m_strSecondFile.c_str(), GENERIC_WRITE, /*shared mode*/0, /*security*/nullptr, CREATE_ALWAYS, outputFlags, /*template*/nullptr), m_strSecondFile);
 	if (!hOutputFile)
 		return false;
 
-	auto inBuf = std::make_unique<uint8_t[]>(m_blockSizeInBytes);
-	auto outBuf = std::make_unique<uint8_t[]>(m_blockSizeInBytes);
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(hInputFile.get(), &fileSize))
+		return false;
+
+	// ReadFile/WriteFile take DWORD sizes
+	const DWORD ioAlignment = unbuffered ? UnbufferedAlignment : 1;
+	const DWORD blockSizeInBytes = static_cast<DWORD>(RoundUp(std::min<size_t>(m_blockSizeInBytes, MAXDWORD - UnbufferedAlignment), ioAlignment));
+	if (blockSizeInBytes != m_blockSizeInBytes)
+		std::wcout << L"Block size changed to " << blockSizeInBytes << L" bytes for unbuffered I/O\n";
+
+	// aligned buffers for unbuffered I/O
+	auto inStorage = std::make_unique<uint8_t[]>(blockSizeInBytes + ioAlignment);
+	auto outStorage = std::make_unique<uint8_t[]>(blockSizeInBytes + ioAlignment);
+	uint8_t* inBuf = inStorage.get() + (ioAlignment - reinterpret_cast<uintptr_t>(inStorage.get()) % ioAlignment) % ioAlignment;
+	uint8_t* outBuf = outStorage.get() + (ioAlignment - reinterpret_cast<uintptr_t>(outStorage.get()) % ioAlignment) % ioAlignment;
+
+	WriteBehindTracker writeBehind(WriteBehindWindowInBytes);
+	WriteBehindTracker* pWriteBehind = m_options.m_writeBehind ? &writeBehind : nullptr;
 
-	DWORD numBytesRead = 0;
-	DWORD numBytesWritten = 0;
 	size_t blockCount = 0;
-	BOOL writeOK = TRUE;
-	while (ReadFile(hInputFile.get(), inBuf.get(), static_cast<DWORD>(m_blockSizeInBytes), &numBytesRead, /*overlapped*/nullptr) && numBytesRead > 0 && writeOK)
+	bool complete = true;
+	if (m_options.m_sparse)
 	{
-		processFunc(inBuf.get(), outBuf.get(), numBytesRead);
+		const auto ranges = QueryDataRanges(hInputFile.get(), static_cast<uint64_t>(fileSize.QuadPart));
+		MakeSparse(hOutputFile.get());
 
-		writeOK = WriteFile(hOutputFile.get(), outBuf.get(), numBytesRead, &numBytesWritten, /*overlapped*/nullptr);
-		
-		if (numBytesRead != numBytesWritten)
-			Logger::PrintErrorTransformingFile(numBytesRead, numBytesWritten);
+		for (const auto& range : ranges)
+		{
+			LARGE_INTEGER pos;
+			pos.QuadPart = static_cast<LONGLONG>(range.m_offset);
+			if (!SetFilePointerEx(hInputFile.get(), pos, nullptr, FILE_BEGIN) || !SetFilePointerEx(hOutputFile.get(), pos, nullptr, FILE_BEGIN))
+				return false;
 
-		blockCount++;
+			complete = TransformBlocks(hInputFile.get(), hOutputFile.get(), m_strSecondFile, inBuf, outBuf, blockSizeInBytes, ioAlignment, range.m_length, processFunc, blockCount, pWriteBehind, m_options.m_pTelemetry);
+			if (!complete)
+				break;
+		}
+
+		Logger::PrintSparseSummary(ranges.size(), SumRanges(ranges), static_cast<uint64_t>(fileSize.QuadPart));
+	}
+	else
+	{
+		complete = TransformBlocks(hInputFile.get(), hOutputFile.get(), m_strSecondFile, inBuf, outBuf, blockSizeInBytes, ioAlignment, UINT64_MAX, processFunc, blockCount, pWriteBehind, m_options.m_pTelemetry);
 	}
 
-	Logger::PrintTransformSummary(blockCount, m_blockSizeInBytes, m_strFirstFile, m_strSecondFile);
+	// holes at the end of sparse files and padding of unbuffered writes, the padding is cut off even after a failure
+	if (m_options.m_sparse || unbuffered)
+	{
+		const bool sizeOK = SetFileSize(hOutputFile.get(), static_cast<uint64_t>(fileSize.QuadPart));
+		complete = complete && sizeOK;
+	}
 
-	return true;
+	if (pWriteBehind)
+	{
+		writeBehind.SampleSystemCache();
+		if (FlushFileBuffers(hOutputFile.get()))
+			writeBehind.Flushed();
+		else
+		{
+			Logger::PrintCannotFlushFile(m_strSecondFile);
+			complete = false;
+		}
+		Logger::PrintWriteBehindSummary(writeBehind);
+	}
+
+	Logger::PrintTransformSummary(blockCount, blockSizeInBytes, m_strFirstFile, m_strSecondFile);
+
+	return complete;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 // MappedWinFileTransformer
 
+namespace
+{
+	// size of a single view when the whole file cannot (or should not) be mapped at once
+	const uint64_t MappedViewWindowInBytes = 64 * 1024 * 1024;
+
+	// the whole file can't be mapped in 32-bit builds
+	bool IsSmallAddressSpace()
+	{
+		return sizeof(SIZE_T) < sizeof(uint64_t);
+	}
+
+	uint64_t GreatestCommonDivisor(uint64_t a, uint64_t b)
+	{
+		while (b != 0)
+		{
+			const auto t = a % b;
+			a = b;
+			b = t;
+		}
+		return a;
+	}
+
+	// view offsets must be aligned to the allocation granularity and views should hold whole blocks,
+	// so the window is a multiple of both, windowInBytes == 0 means the whole file in one view
+	uint64_t ComputeViewSize(uint64_t fileSize, size_t blockSizeInBytes, uint64_t windowInBytes)
+	{
+		if (windowInBytes == 0)
+			return fileSize;
+
+		SYSTEM_INFO sysInfo;
+		GetSystemInfo(&sysInfo);
+		const uint64_t granularity = sysInfo.dwAllocationGranularity;
+		const uint64_t alignment = granularity / GreatestCommonDivisor(granularity, blockSizeInBytes) * blockSizeInBytes;
+
+		return std::max<uint64_t>(windowInBytes / alignment, 1) * alignment;
+	}
+}
 
 // with memory mapped files it's required to use SEH, so we need a separate function to do this
 // see at: https://blogs.msdn.microsoft.com/larryosterman/2006/10/16/so-when-is-it-ok-to-use-seh/
-bool DoProcess(uint8_t* &pIn, uint8_t* ptrInFile, uint8_t* &pOut, uint8_t* ptrOutFile, LARGE_INTEGER &fileSize, const size_t m_blockSizeInBytes, IFileTransformer::TProcessFunc processFunc)
+bool DoProcess(uint8_t* pIn, uint8_t* pOut, size_t sizeInBytes, const size_t m_blockSizeInBytes, IFileTransformer::TProcessFunc processFunc, size_t& blockCount, TransferTelemetry* pTelemetry)
 {
 	size_t bytesProcessed = 0;
 	size_t blockSize = 0;
 
 	__try
 	{
-		pIn = ptrInFile;
-		pOut = ptrOutFile;
-		while (pIn < ptrInFile + fileSize.QuadPart)
+		while (bytesProcessed < sizeInBytes)
 		{
-			blockSize = static_cast<size_t>(static_cast<long long>(bytesProcessed + m_blockSizeInBytes) < fileSize.QuadPart ? m_blockSizeInBytes : fileSize.QuadPart - bytesProcessed);
+			blockSize = std::min<size_t>(m_blockSizeInBytes, sizeInBytes - bytesProcessed);
 			processFunc(pIn, pOut, blockSize);
 			pIn += blockSize;
 			pOut += blockSize;
-			bytesProcessed += m_blockSizeInBytes;
+			bytesProcessed += blockSize;
+			blockCount++;
+
+			if (pTelemetry)
+				pTelemetry->AddBlock(blockSize);
 		}
 		return true;
 	}
@@ -180,7 +462,7 @@ bool DoProcess(uint8_t* &pIn, uint8_t* ptrInFile, uint8_t* &pOut, uint8_t* ptrOu
 
 bool MappedWinFileTransformer::Process(TProcessFunc processFunc)
 {
-	auto hInputFile = make_HANDLE_unique_ptr(CreateFile(m_strFirstFile.c_str(), GENERIC_READ, /*shared mode*/0, /*security*/nullptr, OPEN_EXISTING, m_useSequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, /*template*/nullptr), m_strFirstFile);
+	auto hInputFile = make_HANDLE_unique_ptr(CreateFile(m_strFirstFile.c_str(), GENERIC_READ, /*shared mode*/0, /*security*/nullptr, OPEN_EXISTING, m_options.m_sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, /*template*/nullptr), m_strFirstFile);
 	if (!hInputFile)
 		return false;
 
@@ -189,11 +471,7 @@ bool MappedWinFileTransformer::Process(TProcessFunc processFunc)
 	if (!hOutputFile)
 		return false;
 	
-	bool complete = false;
-	uint8_t* ptrInFile = nullptr; 
-	uint8_t* ptrOutFile = nullptr;
-	uint8_t* pIn = nullptr;
-	uint8_t* pOut = nullptr;
+	bool complete = true;
 
 	HANDLE_unique_ptr hInputMap;
 	HANDLE_unique_ptr hOutputMap;
@@ -201,47 +479,113 @@ bool MappedWinFileTransformer::Process(TProcessFunc processFunc)
 	LARGE_INTEGER fileSize;
 
 	/* Get the input file size. */
-	GetFileSizeEx(hInputFile.get(), &fileSize);
-			
-	/* This is a necessar, but NOT sufficient, test for mappability on 32-bit systems S
-	* Also see the long comment a few lines below */
-	/*if (fileSize.HighPart > 0 && sizeof(SIZE_T) == 4)
-		ReportException(_T("This file is too large to map on a Win32 system."), 4);*/
-
-	/* Create a file mapping object on the input file. Use the file size. */
-	hInputMap = make_HANDLE_unique_ptr(CreateFileMapping(hInputFile.get(), NULL, PAGE_READONLY, 0, 0, NULL), L"Input map");
-	if (!hInputMap)
+	if (!GetFileSizeEx(hInputFile.get(), &fileSize))
 		return false;
 
-	/* Map the input file */
-	ptrInFile = (uint8_t*)MapViewOfFile(hInputMap.get(), FILE_MAP_READ, 0, 0, 0);
-	if (ptrInFile == nullptr)
+	const uint64_t inputSize = static_cast<uint64_t>(fileSize.QuadPart);
+
+	std::vector<FileRange> ranges;
+	if (m_options.m_sparse)
 	{
-		printf("Cannot map input file!\n");
-		return false;
+		ranges = QueryDataRanges(hInputFile.get(), inputSize);
+		MakeSparse(hOutputFile.get()); // before the mapping extends the file
 	}
+	else
+		ranges.push_back(FileRange{ 0, inputSize });
 
-	/*  Create/Open the output file. */
+	/* Create a file mapping object on the input file. Use the file size. */
+	hInputMap = make_HANDLE_unique_ptr(CreateFileMapping(hInputFile.get(), NULL, PAGE_READONLY, 0, 0, NULL), L"Input map");
+	if (!hInputMap)
+		return false;
 
+	/*  Create the output mapping, it extends the output file to the input size. */
 	hOutputMap = make_HANDLE_unique_ptr(CreateFileMapping(hOutputFile.get(), NULL, PAGE_READWRITE, fileSize.HighPart, fileSize.LowPart, NULL), L"Output map");
 	if (!hOutputMap)
 		return false;
 
-	ptrOutFile = (uint8_t*)MapViewOfFile(hOutputMap.get(), FILE_MAP_WRITE, 0, 0, (SIZE_T)fileSize.QuadPart);
-	if (ptrOutFile == nullptr)
+	// on 32-bit the whole file might not fit into the address space, so map it in windows,
+	// sparse files are also mapped in windows so each data range maps only its own part,
+	// write-behind flushes every output view before unmapping it, so views are as big as the write-behind window
+	uint64_t windowInBytes = 0;
+	if (m_options.m_writeBehind)
+		windowInBytes = WriteBehindWindowInBytes;
+	else if (IsSmallAddressSpace() || m_options.m_sparse)
+		windowInBytes = MappedViewWindowInBytes;
+	const uint64_t viewSize = ComputeViewSize(inputSize, m_blockSizeInBytes, windowInBytes);
+
+	WriteBehindTracker writeBehind(WriteBehindWindowInBytes);
+
+	size_t blockCount = 0;
+	for (const auto& range : ranges)
 	{
-		printf("Cannot map output file!\n");
-		UnmapViewOfFile(ptrInFile);
-		return false;
+		const uint64_t rangeEnd = range.m_offset + range.m_length;
+		uint64_t pos = range.m_offset;
+		while (complete && pos < rangeEnd)
+		{
+			// views start at offsets that are multiple of viewSize, so they are properly aligned
+			const uint64_t viewOffset = pos - pos % viewSize;
+			const uint64_t viewEnd = std::min<uint64_t>(viewOffset + viewSize, rangeEnd);
+			const SIZE_T viewBytes = static_cast<SIZE_T>(viewEnd - viewOffset);
+			const DWORD offsetHigh = static_cast<DWORD>(viewOffset >> 32);
+			const DWORD offsetLow = static_cast<DWORD>(viewOffset & 0xFFFFFFFF);
+
+			/* Map the input file */
+			uint8_t* ptrInFile = (uint8_t*)MapViewOfFile(hInputMap.get(), FILE_MAP_READ, offsetHigh, offsetLow, viewBytes);
+			if (ptrInFile == nullptr)
+			{
+				printf("Cannot map input file!\n");
+				return false;
+			}
+
+			uint8_t* ptrOutFile = (uint8_t*)MapViewOfFile(hOutputMap.get(), FILE_MAP_WRITE, offsetHigh, offsetLow, viewBytes);
+			if (ptrOutFile == nullptr)
+			{
+				printf("Cannot map output file!\n");
+				UnmapViewOfFile(ptrInFile);
+				return false;
+			}
+
+			const size_t skipBytes = static_cast<size_t>(pos - viewOffset);
+			complete = DoProcess(ptrInFile + skipBytes, ptrOutFile + skipBytes, static_cast<size_t>(viewEnd - pos), m_blockSizeInBytes, processFunc, blockCount, m_options.m_pTelemetry);
+
+			// dirty pages of the view are written now, instead of by the lazy writer after unmapping,
+			// the pages stay in the file cache though, mapped files can't bypass it
+			if (complete && m_options.m_writeBehind)
+			{
+				writeBehind.AddWritten(viewEnd - pos);
+				writeBehind.SampleSystemCache();
+				if (FlushViewOfFile(ptrOutFile + skipBytes, static_cast<SIZE_T>(viewEnd - pos)))
+					writeBehind.Flushed();
+				else
+				{
+					Logger::PrintCannotFlushFile(m_strSecondFile);
+					complete = false;
+				}
+			}
+
+			/* Close the views. */
+			UnmapViewOfFile(ptrOutFile);
+			UnmapViewOfFile(ptrInFile);
+
+			pos = viewEnd;
+		}
 	}
 
-	DoProcess(pIn, ptrInFile, pOut, ptrOutFile, fileSize, m_blockSizeInBytes, processFunc);
+	if (m_options.m_writeBehind)
+	{
+		// FlushViewOfFile doesn't write the file metadata
+		if (!FlushFileBuffers(hOutputFile.get()))
+		{
+			Logger::PrintCannotFlushFile(m_strSecondFile);
+			complete = false;
+		}
+		Logger::PrintWriteBehindSummary(writeBehind);
+	}
 
-	Logger::PrintTransformSummary((SIZE_T)fileSize.QuadPart/m_blockSizeInBytes, m_blockSizeInBytes, m_strFirstFile, m_strSecondFile);
+	if (m_options.m_sparse)
+		Logger::PrintSparseSummary(ranges.size(), SumRanges(ranges), inputSize);
 
-	/* Close all views and handles. */
-	UnmapViewOfFile(ptrOutFile); 
-	UnmapViewOfFile(ptrInFile);
+	Logger::PrintTransformSummary(blockCount, m_blockSizeInBytes, m_strFirstFile, m_strSecondFile);
 
 	return complete;
 }
@@ -2,6 +2,8 @@
 
 #include <string>
 
+class TransferTelemetry;
+
 // future extension and improvement...
 class ITransformMethod
 {
@@ -19,17 +21,26 @@ public:
 	virtual void Process(uint8_t* inBuf, uint8_t* outBuf, size_t inSize, size_t* pOutSize) = 0;
 };
 
+// optional behaviour of transformers, not every api supports all of the flags
+struct TransformOptions
+{
+	bool m_sequential{ false };	// hint for the system that the input is read sequentially
+	bool m_sparse{ false };		// transform only allocated ranges of the input and leave holes in the output (win, winmap)
+	bool m_writeBehind{ false };	// flush the output every few MB so the amount of dirty pages stays bounded
+	TransferTelemetry* m_pTelemetry{ nullptr };	// optional, receives bytes of every processed block
+};
+
 // base class for our tests, defines basic interface and common methods
 // takes two file names, transforms the first file and writes output to the second file
 // transform using external function, operates on blocks of bytes
 class IFileTransformer
 {
 public:
-	IFileTransformer(std::wstring strFirstFile, std::wstring strSecondFile, size_t blockSizeInBytes, bool useSequential) 
+	IFileTransformer(std::wstring strFirstFile, std::wstring strSecondFile, size_t blockSizeInBytes, TransformOptions options) 
 		: m_strFirstFile(std::move(strFirstFile))
 		, m_strSecondFile(std::move(strSecondFile))
 		, m_blockSizeInBytes(blockSizeInBytes)
-		, m_useSequential(useSequential)
+		, m_options(options)
 	{ }
 	virtual ~IFileTransformer() { }
 
@@ -41,7 +52,7 @@ protected:
 	const std::wstring m_strFirstFile;
 	const std::wstring m_strSecondFile;
 	const size_t m_blockSizeInBytes;
-	const bool m_useSequential;
+	const TransformOptions m_options;
 };
 
 // transformer using STDIO, 
@@ -0,0 +1,414 @@
+// ResultsHelper.cpp
+// reduces benchmark logs into *_res.txt form, computes statistics and compares two result sets
+// exit code 1 means that a statistically significant regression was found, so it can gate a deployment
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// test name ("WIN 1024kb", "CRT 1kb S", "WIN 1024kb writebehind bench") -> measured real times in seconds, keeps tests in the order of the logs
+class TResults
+{
+public:
+	std::vector<double>& operator[](const std::string& strTest)
+	{
+		auto it = m_index.find(strTest);
+		if (it == m_index.end())
+		{
+			it = m_index.emplace(strTest, m_tests.size()).first;
+			m_tests.emplace_back(strTest, std::vector<double>());
+		}
+		return m_tests[it->second].second;
+	}
+
+	const std::vector<double>* Find(const std::string& strTest) const
+	{
+		const auto it = m_index.find(strTest);
+		return it == m_index.end() ? nullptr : &m_tests[it->second].second;
+	}
+
+	bool empty() const { return m_tests.empty(); }
+	std::vector<std::pair<std::string, std::vector<double>>>::const_iterator begin() const { return m_tests.begin(); }
+	std::vector<std::pair<std::string, std::vector<double>>>::const_iterator end() const { return m_tests.end(); }
+
+private:
+	std::vector<std::pair<std::string, std::vector<double>>> m_tests;
+	std::map<std::string, size_t> m_index;
+};
+
+const int ExitOK = 0;
+const int ExitRegression = 1;
+const int ExitError = 2;
+const int ExitMissingTests = 3;	// tests from the base set didn't run (crashed or truncated bench)
+
+struct Stats
+{
+	size_t m_count{ 0 };
+	double m_mean{ 0.0 };
+	double m_stdDev{ 0.0 };
+	double m_min{ 0.0 };
+	double m_median{ 0.0 };
+	double m_ci95{ 0.0 };	// half width of the 95% confidence interval of the mean
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// parsing
+
+std::string Trim(const std::string& str)
+{
+	const auto first = str.find_first_not_of(" \t\r\n");
+	if (first == std::string::npos)
+		return std::string();
+	const auto last = str.find_last_not_of(" \t\r\n");
+	return str.substr(first, last - first + 1);
+}
+
+std::vector<std::string> Split(const std::string& str, char separator)
+{
+	std::vector<std::string> parts;
+	std::stringstream stream(str);
+	std::string part;
+	while (std::getline(stream, part, separator))
+		parts.push_back(Trim(part));
+	return parts;
+}
+
+bool ParseDouble(const std::string& str, double& value)
+{
+	if (str.empty())
+		return false;
+	char* pEnd = nullptr;
+	value = std::strtod(str.c_str(), &pEnd);
+	return *pEnd == '\0';
+}
+
+// "00:00:04.364" from timep.exe -> seconds
+bool ParseTimepTime(const std::string& str, double& seconds)
+{
+	const auto parts = Split(str, ':');
+	if (parts.size() != 3)
+		return false;
+
+	double hours = 0.0, minutes = 0.0, secs = 0.0;
+	if (!ParseDouble(parts[0], hours) || !ParseDouble(parts[1], minutes) || !ParseDouble(parts[2], secs))
+		return false;
+
+	seconds = hours * 3600.0 + minutes * 60.0 + secs;
+	return true;
+}
+
+// understands three kinds of lines, so raw logs and already reduced files can be mixed:
+//   raw timep log:      "SEQUENTIAL", "-- TEST 1kb CRT --", "Real Time: 00:00:04.364"
+//   benchmark record:   "BENCH;WIN;1kb;S;writebehind;4364.2;..." (real time in ms, from the benchmark option of WinFileTests)
+//   reduced results:    "CRT 1kb S;4.364;4.504;..."
+// timep measures the whole process and BENCH only the transform, so BENCH tests get a " bench" suffix
+// and the two are never pooled or compared with each other
+// "BENCH_FAILED;..." marks a run whose transform failed, such a log is rejected
+bool LoadResults(const std::string& strFileName, TResults& results)
+{
+	std::ifstream file(strFileName);
+	if (!file)
+	{
+		std::cerr << "Cannot open " << strFileName << "!\n";
+		return false;
+	}
+
+	bool sequential = false;
+	std::string currentTest;
+	std::string line;
+	while (std::getline(file, line))
+	{
+		line = Trim(line);
+		if (line.empty())
+			continue;
+
+		if (line == "SEQUENTIAL")
+		{
+			sequential = true;
+		}
+		else if (line.compare(0, 8, "-- TEST ") == 0)
+		{
+			// "-- TEST 1kb CRT --" -> "CRT 1kb"
+			std::stringstream stream(line.substr(8));
+			std::string blockSize, apiName;
+			stream >> blockSize >> apiName;
+			currentTest = apiName + " " + blockSize + (sequential ? " S" : "");
+		}
+		else if (line.compare(0, 10, "Real Time:") == 0)
+		{
+			double seconds = 0.0;
+			if (!currentTest.empty() && ParseTimepTime(Trim(line.substr(10)), seconds))
+				results[currentTest].push_back(seconds);
+		}
+		else if (line.compare(0, 13, "BENCH_FAILED;") == 0)
+		{
+			std::cerr << "Failed run in " << strFileName << ": " << line << "\n";
+			return false;
+		}
+		else if (line.compare(0, 6, "BENCH;") == 0)
+		{
+			const auto parts = Split(line, ';');
+			double realTimeInMs = 0.0;
+			// modes (sparse, writebehind) are part of the test name, so such runs are never pooled with normal ones
+			if (parts.size() > 5 && ParseDouble(parts[5], realTimeInMs))
+				results[parts[1] + " " + parts[2] + (parts[3] == "S" ? " S" : "") + (parts[4] != "-" ? " " + parts[4] : "") + " bench"].push_back(realTimeInMs / 1000.0);
+		}
+		else if (line.find(';') != std::string::npos)
+		{
+			const auto parts = Split(line, ';');
+			std::vector<double> values;
+			for (size_t i = 1; i < parts.size(); ++i)
+			{
+				double value = 0.0;
+				if (ParseDouble(parts[i], value))
+					values.push_back(value);
+			}
+
+			if (!values.empty())
+			{
+				auto& target = results[parts[0]];
+				target.insert(target.end(), values.begin(), values.end());
+			}
+		}
+	}
+
+	return true;
+}
+
+bool LoadResults(const std::vector<std::string>& fileNames, TResults& results)
+{
+	for (const auto& strFileName : fileNames)
+	{
+		if (!LoadResults(strFileName, results))
+			return false;
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// statistics
+
+// two sided 95% critical values of Student's t distribution, index = degrees of freedom
+double StudentT95(double degreesOfFreedom)
+{
+	static const double table[] = { 0.0,
+		12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+		2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+		2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+	const size_t tableSize = sizeof(table) / sizeof(table[0]);
+
+	if (degreesOfFreedom < 1.0)
+		return table[1];
+
+	// rounding down the (Welch) degrees of freedom and using the value at the lower bound of each bucket
+	// gives a bigger critical value, which is the conservative choice
+	const auto df = static_cast<size_t>(degreesOfFreedom);
+	if (df < tableSize)
+		return table[df];
+
+	if (df < 40)
+		return 2.042;	// t(30)
+	if (df < 60)
+		return 2.021;	// t(40)
+	if (df < 120)
+		return 2.000;	// t(60)
+	return 1.980;		// t(120)
+}
+
+Stats ComputeStats(std::vector<double> values)
+{
+	Stats stats;
+	stats.m_count = values.size();
+	if (values.empty())
+		return stats;
+
+	std::sort(values.begin(), values.end());
+	stats.m_min = values.front();
+	stats.m_median = values.size() % 2 == 1 ? values[values.size() / 2] : (values[values.size() / 2 - 1] + values[values.size() / 2]) / 2.0;
+
+	double sum = 0.0;
+	for (const auto value : values)
+		sum += value;
+	stats.m_mean = sum / static_cast<double>(values.size());
+
+	if (values.size() > 1)
+	{
+		double sumSq = 0.0;
+		for (const auto value : values)
+			sumSq += (value - stats.m_mean) * (value - stats.m_mean);
+		stats.m_stdDev = std::sqrt(sumSq / static_cast<double>(values.size() - 1));
+		stats.m_ci95 = StudentT95(static_cast<double>(values.size() - 1)) * stats.m_stdDev / std::sqrt(static_cast<double>(values.size()));
+	}
+
+	return stats;
+}
+
+// Welch's t-test, doesn't assume equal variances of both sets
+// returns true when the new mean is significantly (95%) different than the base mean
+bool IsSignificant(const Stats& base, const Stats& current, double& tValue)
+{
+	tValue = 0.0;
+	if (base.m_count < 2 || current.m_count < 2)
+		return false;
+
+	const double baseVar = base.m_stdDev * base.m_stdDev / static_cast<double>(base.m_count);
+	const double currentVar = current.m_stdDev * current.m_stdDev / static_cast<double>(current.m_count);
+	const double sumVar = baseVar + currentVar;
+	if (sumVar <= 0.0)
+		return base.m_mean != current.m_mean;
+
+	tValue = (current.m_mean - base.m_mean) / std::sqrt(sumVar);
+
+	const double df = sumVar * sumVar / (baseVar * baseVar / static_cast<double>(base.m_count - 1) + currentVar * currentVar / static_cast<double>(current.m_count - 1));
+	return std::fabs(tValue) > StudentT95(df);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// commands
+
+int Reduce(const std::vector<std::string>& fileNames)
+{
+	TResults results;
+	if (!LoadResults(fileNames, results))
+		return ExitError;
+
+	for (const auto& entry : results)
+	{
+		std::cout << entry.first << ";";
+		for (const auto value : entry.second)
+			std::cout << value << ";";
+		std::cout << "\n";
+	}
+
+	return ExitOK;
+}
+
+int PrintStats(const std::vector<std::string>& fileNames)
+{
+	TResults results;
+	if (!LoadResults(fileNames, results))
+		return ExitError;
+
+	std::cout << "test;runs;mean;stddev;ci95;min;median\n";
+	for (const auto& entry : results)
+	{
+		const auto stats = ComputeStats(entry.second);
+		std::cout << entry.first << ";" << stats.m_count << ";" << stats.m_mean << ";" << stats.m_stdDev << ";" << stats.m_ci95 << ";" << stats.m_min << ";" << stats.m_median << "\n";
+	}
+
+	return ExitOK;
+}
+
+// a regression is a slowdown that is both significant and bigger than thresholdPercent
+int Compare(const std::string& strBaseFile, const std::string& strNewFile, double thresholdPercent)
+{
+	TResults baseResults, newResults;
+	if (!LoadResults(strBaseFile, baseResults) || !LoadResults(strNewFile, newResults))
+		return ExitError;
+
+	if (baseResults.empty() || newResults.empty())
+	{
+		std::cerr << "No results in " << (baseResults.empty() ? strBaseFile : strNewFile) << "!\n";
+		return ExitError;
+	}
+
+	size_t regressionCount = 0;
+	size_t missingCount = 0;
+	std::cout << "test;base mean;base ci95;new mean;new ci95;change %;t;verdict\n";
+	for (const auto& entry : newResults)
+	{
+		const auto pBaseValues = baseResults.Find(entry.first);
+		if (!pBaseValues)
+		{
+			std::cout << entry.first << ";;;;;;;missing in base\n";
+			continue;
+		}
+
+		const auto baseStats = ComputeStats(*pBaseValues);
+		const auto newStats = ComputeStats(entry.second);
+		const double changePercent = baseStats.m_mean > 0.0 ? (newStats.m_mean - baseStats.m_mean) / baseStats.m_mean * 100.0 : 0.0;
+
+		double tValue = 0.0;
+		const bool significant = IsSignificant(baseStats, newStats, tValue);
+
+		const char* verdict = "same";
+		if (significant && changePercent > thresholdPercent)
+		{
+			verdict = "REGRESSION";
+			regressionCount++;
+		}
+		else if (significant && changePercent < -thresholdPercent)
+			verdict = "improvement";
+		else if (baseStats.m_count < 2 || newStats.m_count < 2)
+			verdict = "too few runs";
+
+		std::cout << entry.first << ";" << baseStats.m_mean << ";" << baseStats.m_ci95 << ";" << newStats.m_mean << ";" << newStats.m_ci95 << ";" << changePercent << ";" << tValue << ";" << verdict << "\n";
+	}
+
+	for (const auto& entry : baseResults)
+	{
+		if (!newResults.Find(entry.first))
+		{
+			std::cout << entry.first << ";;;;;;;MISSING IN NEW\n";
+			missingCount++;
+		}
+	}
+
+	std::cout << regressionCount << " regression(s) found, " << missingCount << " test(s) missing in new\n";
+
+	if (regressionCount > 0)
+		return ExitRegression;
+
+	return missingCount > 0 ? ExitMissingTests : ExitOK;
+}
+
+void PrintUsage()
+{
+	printf("ResultsHelper options:\n");
+	printf("    reduce logFile...                         prints results in the *_res.txt form\n");
+	printf("    stats logFile...                          prints runs, mean, stddev, 95%% CI, min, median per test\n");
+	printf("    compare baseFile newFile (thresholdPct)   exit code 1 when a test is significantly slower by more than threshold (default 5%%)\n");
+	printf("compare exit codes: 0 ok, 1 regression, 2 error or no results, 3 base tests missing in new\n");
+	printf("log files can be raw bench logs (timep or BENCH lines) or reduced *_res.txt files\n");
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		PrintUsage();
+		return ExitError;
+	}
+
+	const std::string strCommand = argv[1];
+	const std::vector<std::string> fileNames(argv + 2, argv + argc);
+
+	if (strCommand == "reduce")
+		return Reduce(fileNames);
+
+	if (strCommand == "stats")
+		return PrintStats(fileNames);
+
+	if (strCommand == "compare" && argc >= 4)
+	{
+		double thresholdPercent = 5.0;
+		if (argc > 4 && !ParseDouble(argv[4], thresholdPercent))
+		{
+			std::cerr << "Wrong threshold " << argv[4] << "\n";
+			return ExitError;
+		}
+
+		return Compare(argv[2], argv[3], thresholdPercent);
+	}
+
+	PrintUsage();
+	return ExitError;
+}
@@ -0,0 +1,87 @@
+#include "Telemetry.h"
+
+#include <cstdio>
+
+namespace
+{
+	bool EndsWith(const std::wstring& str, const std::wstring& suffix)
+	{
+		return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+	}
+}
+
+TransferTelemetry::TransferTelemetry(std::wstring strOutputFile, std::wstring strLabel, unsigned intervalInMs)
+	: m_strOutputFile(std::move(strOutputFile))
+	, m_strLabel(std::move(strLabel))
+	, m_interval(intervalInMs)
+{
+	m_json = EndsWith(m_strOutputFile, L".json") || EndsWith(m_strOutputFile, L".jsonl");
+}
+
+TransferTelemetry::~TransferTelemetry()
+{
+	Stop();
+}
+
+bool TransferTelemetry::Start()
+{
+	m_pFile = make_fopen(m_strOutputFile.c_str(), L"w");
+	if (!m_pFile)
+		return false;
+
+	if (!m_json)
+		fwprintf(m_pFile.get(), L"api,time_ms,bytes,blocks,mb_per_s\n");
+
+	m_timeStart = m_lastSampleTime = std::chrono::steady_clock::now();
+	m_sampler = std::thread(&TransferTelemetry::SamplerLoop, this);
+
+	return true;
+}
+
+void TransferTelemetry::Stop()
+{
+	if (!m_sampler.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_stopEvent.notify_one();
+	m_sampler.join();
+
+	WriteSample(); // the tail after the last full interval
+	m_pFile.reset();
+}
+
+void TransferTelemetry::SamplerLoop()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	auto nextSampleTime = m_timeStart + m_interval;
+	while (!m_stopEvent.wait_until(lock, nextSampleTime, [this] { return m_stop; }))
+	{
+		WriteSample();
+		nextSampleTime += m_interval;
+	}
+}
+
+void TransferTelemetry::WriteSample()
+{
+	const auto now = std::chrono::steady_clock::now();
+	const uint64_t bytes = m_bytes.load(std::memory_order_relaxed);
+	const uint64_t blocks = m_blocks.load(std::memory_order_relaxed);
+
+	const std::chrono::duration<double, std::milli> timeSinceStart = now - m_timeStart;
+	const std::chrono::duration<double> timeSinceLastSample = now - m_lastSampleTime;
+	const double mbPerSec = timeSinceLastSample.count() > 0.0 ? static_cast<double>(bytes - m_lastSampleBytes) / (1024.0 * 1024.0) / timeSinceLastSample.count() : 0.0;
+
+	if (m_json)
+		fwprintf(m_pFile.get(), L"{\"api\":\"%ls\",\"time_ms\":%.1f,\"bytes\":%llu,\"blocks\":%llu,\"mb_per_s\":%.2f}\n", m_strLabel.c_str(), timeSinceStart.count(), bytes, blocks, mbPerSec);
+	else
+		fwprintf(m_pFile.get(), L"%ls,%.1f,%llu,%llu,%.2f\n", m_strLabel.c_str(), timeSinceStart.count(), bytes, blocks, mbPerSec);
+
+	fflush(m_pFile.get()); // so the series can be watched while the transform runs
+
+	m_lastSampleTime = now;
+	m_lastSampleBytes = bytes;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Utils.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// throughput time series of a transform:
+// the transform loop bumps atomic counters after each block, a background thread samples them
+// at fixed intervals and writes one line per sample, CSV or JSON lines (for .json/.jsonl files)
+class TransferTelemetry
+{
+public:
+	TransferTelemetry(std::wstring strOutputFile, std::wstring strLabel, unsigned intervalInMs);
+	~TransferTelemetry();
+
+	TransferTelemetry(const TransferTelemetry&) = delete;
+	TransferTelemetry& operator=(const TransferTelemetry&) = delete;
+
+	// opens the output file and starts the sampler thread
+	bool Start();
+
+	// writes the final sample and joins the sampler thread
+	void Stop();
+
+	// called from the transform loop, only relaxed atomic adds
+	void AddBlock(uint64_t bytes)
+	{
+		m_bytes.fetch_add(bytes, std::memory_order_relaxed);
+		m_blocks.fetch_add(1, std::memory_order_relaxed);
+	}
+
+private:
+	void SamplerLoop();
+	void WriteSample();
+
+	const std::wstring m_strOutputFile;
+	const std::wstring m_strLabel;	// api name, so series from different backends can be plotted together
+	const std::chrono::milliseconds m_interval;
+	bool m_json{ false };
+
+	std::atomic<uint64_t> m_bytes{ 0 };
+	std::atomic<uint64_t> m_blocks{ 0 };
+
+	FILE_unique_ptr m_pFile;
+	std::thread m_sampler;
+	std::mutex m_mutex;
+	std::condition_variable m_stopEvent;
+	bool m_stop{ false };
+
+	std::chrono::steady_clock::time_point m_timeStart;
+	std::chrono::steady_clock::time_point m_lastSampleTime;
+	uint64_t m_lastSampleBytes{ 0 };
+};
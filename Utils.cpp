@@ -1,7 +1,20 @@
 #include "Utils.h"
 
+#include <psapi.h>
+#include <algorithm>
+#include <cwctype>
 #include <iostream>
 
+#pragma comment(lib, "psapi.lib")
+
+namespace
+{
+	uint64_t FileTimeTo100ns(const FILETIME& ft)
+	{
+		return (static_cast<uint64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+	}
+}
+
 namespace Logger
 {
 	void PrintCannotOpenFile(std::wstring strFname)
@@ -18,6 +31,127 @@ namespace Logger
 	{
 		std::wcout << L"Transformed " << blockCount << L" blocks of " << blockSizeInBytes << L" bytes from " << strFirstFile << L" into " << strSecondFile << L"\n";
 	}
+
+	void PrintSparseSummary(size_t rangeCount, uint64_t dataBytes, uint64_t fileSize)
+	{
+		std::wcout << L"Sparse: " << rangeCount << L" data ranges, " << dataBytes << L" of " << fileSize << L" bytes transformed, " << (fileSize - dataBytes) << L" bytes left as holes\n";
+	}
+
+	void PrintWriteBehindSummary(const WriteBehindTracker& writeBehind)
+	{
+		std::wcout << L"Write-behind: " << writeBehind.GetFlushCount() << L" flushes, max " << writeBehind.GetMaxUnflushedBytes() << L" bytes written between flushes, max system cache before a flush " << writeBehind.GetMaxSystemCacheBytes() << L" bytes\n";
+	}
+
+	void PrintCannotFlushFile(std::wstring strFname)
+	{
+		wprintf(L"Cannot flush %s file!\n", strFname.c_str());
+	}
+
+	void PrintResourceUsage(const ResourceUsage& usage)
+	{
+		std::wcout << L"Page Faults: " << usage.m_pageFaults << L", Peak Working Set: " << usage.m_peakWorkingSet << L" bytes\n";
+		std::wcout << L"Read Calls: " << usage.m_readOperations << L" (" << usage.m_readBytes << L" bytes), Write Calls: " << usage.m_writeOperations << L" (" << usage.m_writeBytes << L" bytes), Other Calls: " << usage.m_otherOperations << L"\n";
+		std::wcout << L"User Time: " << usage.m_userTime100ns / 10000.0 << L" ms, Kernel Time: " << usage.m_kernelTime100ns / 10000.0 << L" ms, CPU Cycles: " << usage.m_cpuCycles << L"\n";
+	}
+
+	void PrintBenchmarkFailure(std::wstring strApiName, size_t blockSizeInBytes)
+	{
+		std::transform(strApiName.begin(), strApiName.end(), strApiName.begin(), [](wchar_t c) { return static_cast<wchar_t>(std::towupper(c)); });
+
+		std::wcout << L"BENCH_FAILED;" << strApiName << L";" << (blockSizeInBytes >> 10) << L"kb\n";
+	}
+
+	void PrintBenchmarkRecord(std::wstring strApiName, size_t blockSizeInBytes, bool sequential, bool sparse, bool writeBehind, double realTimeInMs, const ResourceUsage& usage)
+	{
+		std::transform(strApiName.begin(), strApiName.end(), strApiName.begin(), [](wchar_t c) { return static_cast<wchar_t>(std::towupper(c)); });
+
+		std::wstring strModes;
+		if (sparse)
+			strModes = L"sparse";
+		if (writeBehind)
+			strModes += strModes.empty() ? L"writebehind" : L"+writebehind";
+		if (strModes.empty())
+			strModes = L"-";
+
+		// BENCH;api;blockKB;S|-;sparse+writebehind|-;realMs;userMs;sysMs;pageFaults;readCalls;readBytes;writeCalls;writeBytes;otherCalls;cycles;peakWorkingSet
+		std::wcout << L"BENCH;" << strApiName << L";" << (blockSizeInBytes >> 10) << L"kb;" << (sequential ? L"S" : L"-") << L";" << strModes << L";"
+			<< realTimeInMs << L";" << usage.m_userTime100ns / 10000.0 << L";" << usage.m_kernelTime100ns / 10000.0 << L";"
+			<< usage.m_pageFaults << L";" << usage.m_readOperations << L";" << usage.m_readBytes << L";"
+			<< usage.m_writeOperations << L";" << usage.m_writeBytes << L";" << usage.m_otherOperations << L";"
+			<< usage.m_cpuCycles << L";" << usage.m_peakWorkingSet << L"\n";
+	}
+}
+
+bool WriteBehindTracker::AddWritten(uint64_t bytes)
+{
+	m_unflushedBytes += bytes;
+	m_maxUnflushedBytes = std::max<uint64_t>(m_maxUnflushedBytes, m_unflushedBytes);
+	return m_unflushedBytes >= m_windowInBytes;
+}
+
+void WriteBehindTracker::SampleSystemCache()
+{
+	PERFORMANCE_INFORMATION perfInfo{ };
+	if (GetPerformanceInfo(&perfInfo, sizeof(perfInfo)))
+		m_maxSystemCacheBytes = std::max<uint64_t>(m_maxSystemCacheBytes, static_cast<uint64_t>(perfInfo.SystemCache) * perfInfo.PageSize);
+}
+
+void WriteBehindTracker::Flushed()
+{
+	m_unflushedBytes = 0;
+	m_flushCount++;
+}
+
+ResourceUsage ResourceUsage::Capture()
+{
+	ResourceUsage usage;
+	const HANDLE hProcess = GetCurrentProcess();
+
+	PROCESS_MEMORY_COUNTERS memCounters{ };
+	if (GetProcessMemoryInfo(hProcess, &memCounters, sizeof(memCounters)))
+	{
+		usage.m_pageFaults = memCounters.PageFaultCount;
+		usage.m_peakWorkingSet = memCounters.PeakWorkingSetSize;
+	}
+
+	IO_COUNTERS ioCounters{ };
+	if (GetProcessIoCounters(hProcess, &ioCounters))
+	{
+		usage.m_readOperations = ioCounters.ReadOperationCount;
+		usage.m_writeOperations = ioCounters.WriteOperationCount;
+		usage.m_otherOperations = ioCounters.OtherOperationCount;
+		usage.m_readBytes = ioCounters.ReadTransferCount;
+		usage.m_writeBytes = ioCounters.WriteTransferCount;
+	}
+
+	ULONG64 cycles = 0;
+	if (QueryProcessCycleTime(hProcess, &cycles))
+		usage.m_cpuCycles = cycles;
+
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	if (GetProcessTimes(hProcess, &creationTime, &exitTime, &kernelTime, &userTime))
+	{
+		usage.m_userTime100ns = FileTimeTo100ns(userTime);
+		usage.m_kernelTime100ns = FileTimeTo100ns(kernelTime);
+	}
+
+	return usage;
+}
+
+ResourceUsage ResourceUsage::operator-(const ResourceUsage& before) const
+{
+	ResourceUsage diff;
+	diff.m_pageFaults = m_pageFaults - before.m_pageFaults;
+	diff.m_readOperations = m_readOperations - before.m_readOperations;
+	diff.m_writeOperations = m_writeOperations - before.m_writeOperations;
+	diff.m_otherOperations = m_otherOperations - before.m_otherOperations;
+	diff.m_readBytes = m_readBytes - before.m_readBytes;
+	diff.m_writeBytes = m_writeBytes - before.m_writeBytes;
+	diff.m_cpuCycles = m_cpuCycles - before.m_cpuCycles;
+	diff.m_userTime100ns = m_userTime100ns - before.m_userTime100ns;
+	diff.m_kernelTime100ns = m_kernelTime100ns - before.m_kernelTime100ns;
+	diff.m_peakWorkingSet = m_peakWorkingSet;
+	return diff;
 }
 
 void FILEDeleter::operator()(FILE *pFile) const
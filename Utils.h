@@ -3,6 +3,7 @@
 #include "WINEXCLUDE.H"
 #include <windows.h>
 
+#include <cstdint>
 #include <memory>
 #include <string>
 
@@ -29,9 +30,64 @@ FILE_shared_ptr make_fopen_shared(const wchar_t* fname, const wchar_t* mode);
 
 HANDLE_unique_ptr make_HANDLE_unique_ptr(HANDLE handle, std::wstring strMsg);
 
+// snapshot of the process counters, capture one before and one after a transform and subtract them
+// page faults include soft and hard faults, I/O counters don't see memory mapped I/O (it shows up as page faults instead)
+struct ResourceUsage
+{
+	uint64_t m_pageFaults{ 0 };
+	uint64_t m_readOperations{ 0 };
+	uint64_t m_writeOperations{ 0 };
+	uint64_t m_otherOperations{ 0 };	// calls other than read/write, like SetFilePointer or FlushFileBuffers
+	uint64_t m_readBytes{ 0 };
+	uint64_t m_writeBytes{ 0 };
+	uint64_t m_cpuCycles{ 0 };
+	uint64_t m_userTime100ns{ 0 };
+	uint64_t m_kernelTime100ns{ 0 };
+	size_t m_peakWorkingSet{ 0 };		// not a counter, subtraction keeps the value from the later snapshot
+
+	static ResourceUsage Capture();
+
+	ResourceUsage operator-(const ResourceUsage& before) const;
+};
+
+// write-behind accounting: counts output bytes written since the last flush and tells the transformer
+// when a whole window was written; it does not see the OS cache of the file, only what the transformer wrote
+class WriteBehindTracker
+{
+public:
+	explicit WriteBehindTracker(uint64_t windowInBytes) : m_windowInBytes(windowInBytes) { }
+
+	// returns true when the window is full and the output should be flushed
+	bool AddWritten(uint64_t bytes);
+
+	// call right before flushing, records the system wide file cache size (it's at its largest then)
+	void SampleSystemCache();
+
+	// call after the flush succeeded
+	void Flushed();
+
+	size_t GetFlushCount() const { return m_flushCount; }
+	uint64_t GetMaxUnflushedBytes() const { return m_maxUnflushedBytes; }
+	uint64_t GetMaxSystemCacheBytes() const { return m_maxSystemCacheBytes; }
+
+private:
+	const uint64_t m_windowInBytes;
+	uint64_t m_unflushedBytes{ 0 };
+	uint64_t m_maxUnflushedBytes{ 0 };		// bounded by the window plus one block, unless flushes fail
+	uint64_t m_maxSystemCacheBytes{ 0 };	// whole system, not only our files
+	size_t m_flushCount{ 0 };
+};
+
 namespace Logger
 {
 	void PrintCannotOpenFile(std::wstring strFname);
 	void PrintErrorTransformingFile(size_t numRead, size_t numWritten);
 	void PrintTransformSummary(size_t blockCount, size_t blockSizeInBytes, std::wstring strFirstFile, std::wstring strSecondFile);
+	void PrintSparseSummary(size_t rangeCount, uint64_t dataBytes, uint64_t fileSize);
+	void PrintWriteBehindSummary(const WriteBehindTracker& writeBehind);
+	void PrintCannotFlushFile(std::wstring strFname);
+	void PrintResourceUsage(const ResourceUsage& usage);
+	// one line, semicolon separated, easy to parse by ResultsHelper
+	void PrintBenchmarkFailure(std::wstring strApiName, size_t blockSizeInBytes);
+	void PrintBenchmarkRecord(std::wstring strApiName, size_t blockSizeInBytes, bool sequential, bool sparse, bool writeBehind, double realTimeInMs, const ResourceUsage& usage);
 }
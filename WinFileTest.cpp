@@ -9,9 +9,12 @@
 #include <string>
 #include <memory>
 #include <iostream>
+#include <chrono>
 
 #include "FileTransformers.h"
 #include "FileCreators.h"
+#include "Utils.h"
+#include "Telemetry.h"
 
 // function used to just copy one file into another
 void CopyTransform(uint8_t *inBuf, uint8_t *outBuf, size_t sizeInBytes)
@@ -40,6 +43,10 @@ struct AppParams
 	size_t m_secondSize{ 0 };
 	bool m_benchmark{ false };
 	bool m_sequential{ false };
+	bool m_sparse{ false };
+	bool m_writeBehind{ false };
+	std::wstring m_strTelemetryFileName;
+	unsigned m_telemetryIntervalInMs{ 100 };
 };
 
 AppParams ParseCmd(int argc, LPTSTR * argv)
@@ -50,7 +57,8 @@ AppParams ParseCmd(int argc, LPTSTR * argv)
 	{
 		printf("WinFileTests options:\n");
 		printf("    create ApiName filename sizeInMB blockSizeInKilobytes\n");
-		printf("    transform ApiName filenameSrc filenameOut blockSizeInKilobytes (seq)\n");
+		printf("    transform ApiName filenameSrc filenameOut blockSizeInKilobytes (seq) (sparse) (writebehind) (benchmark)\n");
+		printf("        (telemetry=file.csv|file.jsonl) (interval=sampleIntervalInMs)\n");
 		printf("    clear fileName\n");
 		printf("api names: crt, std, win, winmap\n");
 		return outParams;
@@ -122,12 +130,24 @@ AppParams ParseCmd(int argc, LPTSTR * argv)
 		}
 	}
 
-	if ((outParams.m_mode == AppMode::Transform && argc > currentArg+1 && wcscmp(argv[++currentArg], L"seq") == 0))
-		outParams.m_sequential = true;
-
-	// possible future use...
-	//if ((outParams.m_mode != AppMode::Invalid && argc > currentArg+1 && wcscmp(argv[++currentArg], L"benchmark") == 0))
-	//	outParams.m_benchmark = true;
+	// optional flags, in any order
+	while (outParams.m_mode == AppMode::Transform && ++currentArg < argc)
+	{
+		if (wcscmp(argv[currentArg], L"seq") == 0)
+			outParams.m_sequential = true;
+		else if (wcscmp(argv[currentArg], L"sparse") == 0)
+			outParams.m_sparse = true;
+		else if (wcscmp(argv[currentArg], L"writebehind") == 0)
+			outParams.m_writeBehind = true;
+		else if (wcscmp(argv[currentArg], L"benchmark") == 0)
+			outParams.m_benchmark = true;
+		else if (wcsncmp(argv[currentArg], L"telemetry=", 10) == 0)
+			outParams.m_strTelemetryFileName = std::wstring(argv[currentArg] + 10);
+		else if (wcsncmp(argv[currentArg], L"interval=", 9) == 0 && _wtoi(argv[currentArg] + 9) > 0)
+			outParams.m_telemetryIntervalInMs = static_cast<unsigned>(_wtoi(argv[currentArg] + 9));
+		else
+			std::wcout << L"Unknown option " << argv[currentArg] << L" ignored\n";
+	}
 
 	return outParams;
 }
@@ -143,25 +163,80 @@ void CreateFile(const AppParams& params)
 
 }
 
-void TransformFiles(const AppParams& params)
+bool TransformFiles(const AppParams& params)
 {
+	TransformOptions options;
+	options.m_sequential = params.m_sequential;
+	options.m_sparse = params.m_sparse;
+	options.m_writeBehind = params.m_writeBehind;
+
+	std::unique_ptr<TransferTelemetry> ptrTelemetry;
+	if (!params.m_strTelemetryFileName.empty())
+	{
+		ptrTelemetry = std::make_unique<TransferTelemetry>(params.m_strTelemetryFileName, params.m_strApiName, params.m_telemetryIntervalInMs);
+		options.m_pTelemetry = ptrTelemetry.get();
+	}
+
+	if (options.m_sparse && params.m_strApiName != L"win" && params.m_strApiName != L"winmap")
+	{
+		printf("sparse mode is supported only by win and winmap, ignored...\n");
+		options.m_sparse = false;
+	}
+
+	// win bypasses the file cache, crt and winmap can only flush (Windows has no fadvise to drop cached pages),
+	// streams don't expose the OS handle so they can't even flush to the disk
+	if (options.m_writeBehind && params.m_strApiName == L"std")
+	{
+		printf("writebehind is not supported by std, ignored...\n");
+		options.m_writeBehind = false;
+	}
+	else if (options.m_writeBehind && (params.m_strApiName == L"crt" || params.m_strApiName == L"winmap"))
+		printf("writebehind for crt and winmap bounds only the dirty data, cached pages are not evicted...\n");
+
 	std::unique_ptr<IFileTransformer> ptrTransformer;
 	if (params.m_strApiName == L"crt")
-		ptrTransformer.reset(new StdioFileTransformer(params.m_strFirstFileName, params.m_strSecondFileName, params.m_byteSize, params.m_sequential));
+		ptrTransformer.reset(new StdioFileTransformer(params.m_strFirstFileName, params.m_strSecondFileName, params.m_byteSize, options));
 	else if (params.m_strApiName == L"std")
-		ptrTransformer.reset(new IoStreamFileTransformer(params.m_strFirstFileName, params.m_strSecondFileName, params.m_byteSize, params.m_sequential));
+		ptrTransformer.reset(new IoStreamFileTransformer(params.m_strFirstFileName, params.m_strSecondFileName, params.m_byteSize, options));
 	else if (params.m_strApiName == L"win")
-		ptrTransformer.reset(new WinFileTransformer(params.m_strFirstFileName, params.m_strSecondFileName, params.m_byteSize, params.m_sequential));
+		ptrTransformer.reset(new WinFileTransformer(params.m_strFirstFileName, params.m_strSecondFileName, params.m_byteSize, options));
 	else if (params.m_strApiName == L"winmap")
-		ptrTransformer.reset(new MappedWinFileTransformer(params.m_strFirstFileName, params.m_strSecondFileName, params.m_byteSize, params.m_sequential));
+		ptrTransformer.reset(new MappedWinFileTransformer(params.m_strFirstFileName, params.m_strSecondFileName, params.m_byteSize, options));
 	else
 	{
 		printf("unrecognized api...\n");
-		return;
+		return false;
 	}
 
+	bool transformOK = false;
 	if (ptrTransformer)
-		ptrTransformer->Process(CopyTransform);
+	{
+		if (ptrTelemetry)
+			ptrTelemetry->Start(); // if the file cannot be opened the counters are just not sampled
+
+		// the sampler thread runs during the transform, so its CPU time and its writes to the telemetry file
+		// are included in the counters; starting and stopping it is not
+		const auto usageBefore = ResourceUsage::Capture();
+		const auto timeStart = std::chrono::steady_clock::now();
+
+		transformOK = ptrTransformer->Process(CopyTransform);
+
+		const std::chrono::duration<double, std::milli> realTime = std::chrono::steady_clock::now() - timeStart;
+		const auto usage = ResourceUsage::Capture() - usageBefore;
+
+		if (ptrTelemetry)
+			ptrTelemetry->Stop();
+
+		Logger::PrintResourceUsage(usage);
+
+		// times of a broken run must not be mixed with good runs, ResultsHelper rejects logs with failure markers
+		if (params.m_benchmark && transformOK)
+			Logger::PrintBenchmarkRecord(params.m_strApiName, params.m_byteSize, options.m_sequential, options.m_sparse, options.m_writeBehind, realTime.count(), usage);
+		else if (params.m_benchmark)
+			Logger::PrintBenchmarkFailure(params.m_strApiName, params.m_byteSize);
+	}
+
+	return transformOK;
 }
 
 void ClearFileCache(const AppParams& params)
@@ -185,7 +260,8 @@ int _tmain(int argc, LPTSTR argv[])
 	}
 	else if (params.m_mode == AppMode::Transform)
 	{
-		TransformFiles(params);
+		if (!TransformFiles(params))
+			return 1;
 	}
 	else if (params.m_mode == AppMode::ClearCache)
 	{